@@ -5,17 +5,55 @@ You should write all your code here.
 */
 
 #include "disk.h"
+#include "iosched.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <inttypes.h>
 
 //possible states for a flash page
 #define PAGE_FREE 0
 #define PAGE_VALID 1
 #define PAGE_INVALID 2
 
+//largest page or block count the FTL tables can index
+#define FTL_MAX_INDEX UINT32_MAX
+
+//read-ahead tuning
+#define RA_STREAMS 4       //number of concurrent streams tracked
+#define RA_WINDOW 8        //pages prefetched per stream refill
+#define RA_TRIGGER 3       //stride repeats needed before prefetching
+#define RA_MAX_STRIDE 16   //largest stride treated as a stream
+
+//background GC page operations dispatched after each host write, reads never run GC
+#define GC_OPS_PER_WRITE 1
+
+//queued prefetches dispatched after each host read
+#define RA_OPS_PER_READ 1
+
+//disk.h can't see enum io_class, so fail the build if the queue counts drift apart
+typedef char disk_stats_queues_match[DISK_STATS_QUEUES == IO_NCLASSES ? 1 : -1];
+
+//states of a read-ahead staging slot
+#define RA_PENDING 0       //prefetch queued but not yet dispatched
+#define RA_READY 1         //data staged and not yet read
+#define RA_USED 2          //read by the host, overwritten or abandoned
+
+//a sequential or strided read stream and its staged pages
+struct ra_stream {
+	int64_t last_block;     //last disk block read by this stream, -1 if unused
+	int64_t stride;         //distance between consecutive reads
+	int hits;               //consecutive reads matching stride
+	int age;                //last use time for replacement
+	int nstaged;            //number of pages in the staging buffer
+	int gen;                //bumped whenever the window is dropped
+	int64_t staged_block[RA_WINDOW];  //disk block held in each staging slot
+	int staged_state[RA_WINDOW];  //RA_PENDING, RA_READY or RA_USED
+	char *staged;           //RA_WINDOW * DISK_BLOCK_SIZE bytes of staged data
+};
+
 /*
 Structure of the flash translation layer.
 Go ahead and add or change things here as needed.
@@ -23,33 +61,100 @@ Go ahead and add or change things here as needed.
 
 struct disk {
 	struct flash_drive *flash_drive;
-	int disk_blocks;        //number of logical disk blocks
-	int flash_pages;        //number of flash pages
+	int64_t disk_blocks;    //number of logical disk blocks
+	int64_t flash_pages;    //number of flash pages
 	int pages_per_block;    //number of pages in each flash block
-	int flash_blocks;       //number of flash blocks
+	int64_t flash_blocks;   //number of flash blocks
+
+	//mapping tables hold index+1 so that a zeroed entry means unmapped and
+	//they can come straight from calloc; the per-block counts below keep
+	//searches at block granularity, so page entries of blocks never used
+	//are not touched
+	uint32_t *block_to_page;      //maps disk blocks to flash pages
+	uint32_t *page_to_block;      //reverse mapping - flash pages to disk blocks
+	unsigned char *page_status;   //status of each flash page
+	uint32_t *erase_count;        //count of erases for each flash block
+	uint32_t *block_free;         //free pages in each flash block
+	uint32_t *block_invalid;      //invalid pages in each flash block
+	int64_t free_pages;           //free pages in all flash blocks
+
+	//new pages come from one open block; the others with free pages wait in a
+	//min-heap on erase count and cleaning victims are listed by invalid count,
+	//so neither search walks every block
+	int64_t open_block;           //block new pages are taken from, -1 if none
+	uint32_t *free_heap;          //blocks with free pages other than open_block
+	uint32_t *heap_pos;           //position+1 of each block in free_heap, 0 if absent
+	int64_t heap_size;
+	uint32_t *invalid_head;       //block+1 heading the list for each invalid count
+	uint32_t *invalid_next;       //block+1 of the next and previous block in the same list
+	uint32_t *invalid_prev;
+	int max_invalid;              //no block has more invalid pages than this
+
+	struct io_sched *io;    //queues all operations on the flash drive
+	int64_t gc_block;       //block being cleaned in the background, -1 if none
+	int gc_pending;         //migrations queued for gc_block
 
-	int *block_to_page;     //maps disk blocks to flash pages
-    int *page_to_block;     //reverse mapping - flash pages to disk blocks
-	int *page_status;       //status of each flash page
-	int *erase_count;       //count of erases for each flash block
+	struct ra_stream streams[RA_STREAMS]; //read-ahead streams
+	int ra_clock;           //incremented on every read for stream aging
 
-	int nreads;
-	int nwrites;
+	int64_t nreads;
+	int64_t nwrites;
+	int64_t read_us;        //time spent in disk_read
+	int64_t write_us;       //time spent in disk_write
+	int64_t gc_runs;        //blocks chosen for cleaning
+	int64_t gc_migrated;    //valid pages moved by cleaning
+	int64_t ra_prefetched;  //pages read ahead into staging buffers
+	int64_t ra_hits;        //reads served from a staging buffer
+	int64_t ra_wasted;      //staged pages dropped without being read
+
+	FILE *stats_out;        //periodic JSON statistics, NULL if off
+	int64_t stats_interval; //host operations between JSON lines
 };
 
-int find_free_page(struct disk *d, int preferred_block);
-int select_block_to_clean(struct disk *d);
-void clean_block(struct disk *d, int block_num);
+int64_t get_page(struct disk *d, int64_t disk_block);
+void set_page(struct disk *d, int64_t disk_block, int64_t page);
+int64_t get_block(struct disk *d, int64_t page);
+void set_block(struct disk *d, int64_t page, int64_t disk_block);
+void set_status(struct disk *d, int64_t page, int status);
+int64_t find_free_page(struct disk *d, int64_t preferred_block);
+int64_t select_block_to_clean(struct disk *d);
+int64_t count_free_pages(struct disk *d, int64_t avoid_block);
+void heap_push(struct disk *d, int64_t block_num);
+int64_t heap_pop(struct disk *d);
+void heap_sift_down(struct disk *d, int64_t i);
+void invalid_link(struct disk *d, int64_t block_num, int count);
+void invalid_unlink(struct disk *d, int64_t block_num, int count);
+void block_erased(struct disk *d, int64_t block_num);
+void clean_block(struct disk *d, int64_t block_num);
+int gc_start(struct disk *d, int64_t block_num);
+void gc_finish(struct disk *d);
+void ftl_read(struct disk *d, enum io_class c, int64_t page, char *data);
+void ftl_write(struct disk *d, enum io_class c, int64_t page, const char *data);
+void ftl_copy(struct disk *d, enum io_class c, int64_t src_page, int64_t dst_page);
+void ftl_erase(struct disk *d, enum io_class c, int64_t block_num);
+int ra_lookup(struct disk *d, int64_t disk_block, char *data);
+void ra_update(struct disk *d, int64_t disk_block);
+void ra_invalidate(struct disk *d, int64_t disk_block);
+void ra_drop(struct disk *d, struct ra_stream *s);
+void stats_tick(struct disk *d);
+void disk_free(struct disk *d);
 
 /*
 Create a new flash translation layer for this flash drive f, and simulated number of blocks
 Go ahead and add or change things here as needed.
 */
 
-struct disk * disk_create( struct flash_drive *f, int disk_blocks )
+struct disk * disk_create( struct flash_drive *f, int64_t disk_blocks )
 {
+    // tables index pages and blocks with 32 bits
+    if (disk_blocks <= 0 || disk_blocks > FTL_MAX_INDEX || flash_npages(f) > FTL_MAX_INDEX) {
+        fprintf(stderr, "disk_create: geometry of %"PRId64" disk blocks on %"PRId64" flash pages is out of range\n",
+                disk_blocks, flash_npages(f));
+        return NULL;
+    }
+
 	// Allocate memory for the disk structure
-    struct disk *d = malloc(sizeof(*d));
+    struct disk *d = calloc(1, sizeof(*d));
     if (d == NULL) {
         fprintf(stderr, "Memory allocation failed for disk structure\n");
         return NULL;
@@ -61,30 +166,75 @@ struct disk * disk_create( struct flash_drive *f, int disk_blocks )
     d->pages_per_block = flash_npages_per_block(f);
     d->flash_blocks = d->flash_pages / d->pages_per_block;
     
-    // init mapping tables
-    d->block_to_page = malloc(sizeof(int) * disk_blocks);
-    d->page_to_block = malloc(sizeof(int) * d->flash_pages);
-    d->page_status = malloc(sizeof(int) * d->flash_pages);
-    d->erase_count = malloc(sizeof(int) * d->flash_blocks);
-    
-    // init all mappings and states
-    for (int i = 0; i < disk_blocks; i++) {
-        d->block_to_page[i] = -1;  // no mapping initially
+    // init mapping tables: zeroed entries are unmapped, pages free, erase counts 0
+    d->block_to_page = calloc(disk_blocks, sizeof(*d->block_to_page));
+    d->page_to_block = calloc(d->flash_pages, sizeof(*d->page_to_block));
+    d->page_status = calloc(d->flash_pages, sizeof(*d->page_status));
+    d->erase_count = calloc(d->flash_blocks, sizeof(*d->erase_count));
+    d->block_free = malloc(sizeof(*d->block_free) * d->flash_blocks);
+    d->block_invalid = calloc(d->flash_blocks, sizeof(*d->block_invalid));
+    d->free_heap = malloc(sizeof(*d->free_heap) * d->flash_blocks);
+    d->heap_pos = malloc(sizeof(*d->heap_pos) * d->flash_blocks);
+    d->invalid_head = calloc(d->pages_per_block + 1, sizeof(*d->invalid_head));
+    d->invalid_next = calloc(d->flash_blocks, sizeof(*d->invalid_next));
+    d->invalid_prev = calloc(d->flash_blocks, sizeof(*d->invalid_prev));
+    if (!d->block_to_page || !d->page_to_block || !d->page_status || !d->erase_count
+            || !d->block_free || !d->block_invalid || !d->free_heap || !d->heap_pos
+            || !d->invalid_head || !d->invalid_next || !d->invalid_prev) {
+        fprintf(stderr, "Memory allocation failed for mapping tables\n");
+        disk_free(d);
+        return NULL;
     }
-    
-    // page metadata: no reverse mapping, all pages free
-    for (int i = 0; i < d->flash_pages; i++) {
-        d->page_to_block[i] = -1;  // no reverse mapping initially
-        d->page_status[i] = PAGE_FREE;
+
+    // every page of every whole block starts out free, and with equal erase
+    // counts the blocks in index order already form a heap
+    for (int64_t b = 0; b < d->flash_blocks; b++) {
+        d->block_free[b] = d->pages_per_block;
+        d->free_heap[b] = (uint32_t)b;
+        d->heap_pos[b] = (uint32_t)(b + 1);
     }
-    
-    // init erase count to 0
-    for (int i = 0; i < d->flash_blocks; i++) {
-        d->erase_count[i] = 0;
+    d->free_pages = d->flash_blocks * d->pages_per_block;
+    d->heap_size = d->flash_blocks;
+    d->open_block = -1;
+    d->max_invalid = 0;
+
+    d->io = io_sched_create(f);
+    if (d->io == NULL) {
+        fprintf(stderr, "Memory allocation failed for I/O scheduler\n");
+        disk_free(d);
+        return NULL;
+    }
+    d->gc_block = -1;
+    d->gc_pending = 0;
+
+    // no streams detected yet
+    for (int i = 0; i < RA_STREAMS; i++) {
+        d->streams[i].last_block = -1;
+        d->streams[i].stride = 0;
+        d->streams[i].hits = 0;
+        d->streams[i].age = 0;
+        d->streams[i].nstaged = 0;
+        d->streams[i].gen = 0;
+        d->streams[i].staged = malloc(RA_WINDOW * DISK_BLOCK_SIZE);
+        if (d->streams[i].staged == NULL) {
+            fprintf(stderr, "Memory allocation failed for read-ahead buffers\n");
+            disk_free(d);
+            return NULL;
+        }
     }
+    d->ra_clock = 0;
     
 	d->nreads = 0;
 	d->nwrites = 0;
+	d->read_us = 0;
+	d->write_us = 0;
+	d->gc_runs = 0;
+	d->gc_migrated = 0;
+	d->stats_out = NULL;
+	d->stats_interval = 0;
+	d->ra_prefetched = 0;
+	d->ra_hits = 0;
+	d->ra_wasted = 0;
 	return d;
 }
 
@@ -93,18 +243,30 @@ Read a disk block through the flash translation layer.
 Go ahead and add or change things here as needed.
 */
 
-int disk_read( struct disk *d, int disk_block, char *data )
+int disk_read( struct disk *d, int64_t disk_block, char *data )
 {
-	printf("disk_read: block %d\n", disk_block);
+	int64_t start = flash_now_us();
+	printf("disk_read: block %"PRId64"\n", disk_block);
 	
     // check if the disk block is valid
     if (disk_block < 0 || disk_block >= d->disk_blocks) {
-        fprintf(stderr, "disk_read: invalid block number %d\n", disk_block);
+        fprintf(stderr, "disk_read: invalid block number %"PRId64"\n", disk_block);
         return -1;
     }
     
+    // serve from a read-ahead staging buffer if possible
+    if (ra_lookup(d, disk_block, data)) {
+        d->ra_hits++;
+        ra_update(d, disk_block);
+        io_background(d->io, IO_PREFETCH, RA_OPS_PER_READ);
+        d->nreads++;
+        d->read_us += flash_now_us() - start;
+        stats_tick(d);
+        return 0;
+    }
+
     // get the flash page mapped to the disk block
-    int flash_page = d->block_to_page[disk_block];
+    int64_t flash_page = get_page(d, disk_block);
     // printf("  [Mapping] disk_block %d -> flash_page %d\n", disk_block, flash_page);
     
     // If no flash page is mapped to this block, return zeros
@@ -114,7 +276,7 @@ int disk_read( struct disk *d, int disk_block, char *data )
         memset(data, 0, DISK_BLOCK_SIZE);
     } else {
         // int status = d->page_status[flash_page];
-        // int mapped_block = d->page_to_block[flash_page];
+        // int mapped_block = get_block(d, flash_page);
         // check: verify page is valid and points to correct block
         // if (status != PAGE_VALID || mapped_block != disk_block) {
         //     fprintf(stderr, "  ERROR: Invalid mapping! flash_page %d has status=%d, maps to disk block %d (expected %d)\n",
@@ -125,7 +287,7 @@ int disk_read( struct disk *d, int disk_block, char *data )
         // read the data from the mapped flash page
         // printf("  [Action] Reading from flash page %d\n", flash_page);
         
-        flash_read(d->flash_drive, flash_page, data);
+        ftl_read(d, IO_HOST_READ, flash_page, data);
         
         // printf("  [Debug] First 8 bytes of read data: ");
         // for (int i = 0; i < 8; i++) {
@@ -133,7 +295,11 @@ int disk_read( struct disk *d, int disk_block, char *data )
         // }
         // printf("\n");
     }
+    ra_update(d, disk_block);
+    io_background(d->io, IO_PREFETCH, RA_OPS_PER_READ);
 	d->nreads++;
+	d->read_us += flash_now_us() - start;
+	stats_tick(d);
 	return 0;
 }
 
@@ -142,22 +308,42 @@ Write a disk block through the flash translation layer.
 Go ahead and add or change things here as needed.
 */
 
-int disk_write( struct disk *d, int disk_block, const char *data )
+int disk_write( struct disk *d, int64_t disk_block, const char *data )
 {
-	printf("disk_write: block %d\n",disk_block);
+	int64_t start = flash_now_us();
+	printf("disk_write: block %"PRId64"\n",disk_block);
 
 	if (disk_block < 0 || disk_block >= d->disk_blocks) {
-        fprintf(stderr, "disk_write: invalid block number %d\n", disk_block);
+        fprintf(stderr, "disk_write: invalid block number %"PRId64"\n", disk_block);
         return -1;
     }
     
-    //find a free page to write the data
-    int new_page = find_free_page(d, -1);
+    // start cleaning in the background while a block's worth of free pages remains,
+    // so GC can copy valid pages out instead of staging them
+    if (d->gc_block < 0 && count_free_pages(d, -1) <= d->pages_per_block) {
+        int64_t block_to_clean = select_block_to_clean(d);
+        if (block_to_clean >= 0 && !gc_start(d, block_to_clean)) {
+            clean_block(d, block_to_clean); // no room to copy out, clean in place
+        }
+    }
+
+    // keep a destination for every queued migration plus this write
+    while (d->gc_block >= 0 && count_free_pages(d, d->gc_block) <= d->gc_pending) {
+        if (!io_dispatch(d->io)) break;
+    }
+
+    //find a free page to write the data, never in the block being cleaned
+    int64_t new_page = find_free_page(d, d->gc_block);
     // printf("  [Find] Initial free page search result: %d\n", new_page);
 
+    if (new_page < 0 && d->gc_block >= 0) {
+        gc_finish(d);
+        new_page = find_free_page(d, -1);
+    }
+
     // garbage collection if needed
     if (new_page < 0) {
-        int block_to_clean = select_block_to_clean(d);
+        int64_t block_to_clean = select_block_to_clean(d);
         if (block_to_clean >= 0) {
             // printf("  [GC] Cleaning block %d\n", block_to_clean);
             clean_block(d, block_to_clean);
@@ -167,8 +353,9 @@ int disk_write( struct disk *d, int disk_block, const char *data )
 
     // wear-leveling fallback
     if (new_page < 0) {
-        int min_block = 0, min_count = d->erase_count[0];
-        for (int i = 1; i < d->flash_blocks; i++) {
+        int64_t min_block = 0;
+        uint32_t min_count = d->erase_count[0];
+        for (int64_t i = 1; i < d->flash_blocks; i++) {
             if (d->erase_count[i] < min_count) {
                 min_count = d->erase_count[i];
                 min_block = i;
@@ -184,25 +371,97 @@ int disk_write( struct disk *d, int disk_block, const char *data )
         return -1;
     }
 
-    int old_page = d->block_to_page[disk_block];
+    // any staged copy of this block is now stale
+    ra_invalidate(d, disk_block);
+
+    int64_t old_page = get_page(d, disk_block);
     if (old_page >= 0) {
-        d->page_status[old_page] = PAGE_INVALID;
-        d->page_to_block[old_page] = -1;
+        set_status(d, old_page, PAGE_INVALID);
+        set_block(d, old_page, -1);
     }
 
     // write new data
-    flash_write(d->flash_drive, new_page, data);
+    ftl_write(d, IO_HOST_WRITE, new_page, data);
     // printf("  [Write] Writing data to flash page %d for disk_block %d\n", new_page, disk_block);
 
     // update mapping
-    d->block_to_page[disk_block] = new_page;
-    d->page_to_block[new_page] = disk_block;
-    d->page_status[new_page] = PAGE_VALID;
+    set_page(d, disk_block, new_page);
+    set_block(d, new_page, disk_block);
+    set_status(d, new_page, PAGE_VALID);
 
+    io_background(d->io, IO_GC_MIGRATE, GC_OPS_PER_WRITE);
     d->nwrites++;
+    d->write_us += flash_now_us() - start;
+    stats_tick(d);
     return 0;
 }
 
+/*
+Take a snapshot of the counters without disturbing the disk.
+*/
+
+void disk_get_stats( struct disk *d, struct disk_stats *s )
+{
+    s->nreads = d->nreads;
+    s->nwrites = d->nwrites;
+    s->read_us = d->read_us;
+    s->write_us = d->write_us;
+    s->gc_runs = d->gc_runs;
+    s->gc_pages_migrated = d->gc_migrated;
+    s->write_amplification = d->nwrites ? (double)(d->nwrites + d->gc_migrated) / d->nwrites : 0;
+    s->free_pages = count_free_pages(d, -1);
+    s->flash_pages = d->flash_pages;
+    s->prefetched = d->ra_prefetched;
+    s->prefetch_hits = d->ra_hits;
+    s->prefetch_wasted = d->ra_wasted;
+
+    // staged pages not read yet would be wasted if the run ended now
+    for (int i = 0; i < RA_STREAMS; i++) {
+        for (int j = 0; j < d->streams[i].nstaged; j++) {
+            if (d->streams[i].staged_state[j] == RA_READY) {
+                s->prefetch_wasted++;
+            }
+        }
+    }
+
+    // spread the erase counts evenly over the histogram buckets
+    s->erase_min = UINT32_MAX;
+    s->erase_max = 0;
+    for (int64_t b = 0; b < d->flash_blocks; b++) {
+        if (d->erase_count[b] < s->erase_min) s->erase_min = d->erase_count[b];
+        if (d->erase_count[b] > s->erase_max) s->erase_max = d->erase_count[b];
+    }
+    if (d->flash_blocks == 0) s->erase_min = 0;
+    s->erase_bucket_width = (s->erase_max - s->erase_min) / DISK_STATS_BUCKETS + 1;
+
+    memset(s->erase_histogram, 0, sizeof(s->erase_histogram));
+    for (int64_t b = 0; b < d->flash_blocks; b++) {
+        s->erase_histogram[(d->erase_count[b] - s->erase_min) / s->erase_bucket_width]++;
+    }
+
+    for (int c = 0; c < DISK_STATS_QUEUES; c++) {
+        s->queues[c].depth = io_depth(d->io, c);
+        s->queues[c].max_depth = io_max_depth(d->io, c);
+        s->queues[c].ndispatched = io_ndispatched(d->io, c);
+        s->queues[c].avg_wait_us = io_avg_wait(d->io, c);
+    }
+}
+
+void disk_set_stats_interval( struct disk *d, FILE *out, int64_t ops )
+{
+    d->stats_out = ops > 0 ? out : NULL;
+    d->stats_interval = ops;
+}
+
+/*
+Finish queued background GC.
+*/
+
+void disk_flush( struct disk *d )
+{
+	gc_finish(d);
+}
+
 /*
 Report the total number of operations performed.
 You can add more if you like here, but keep the display of reads and writes.
@@ -210,82 +469,147 @@ You can add more if you like here, but keep the display of reads and writes.
 
 void disk_report( struct disk *d )
 {
-	printf("\tdisk reads: %d\n",d->nreads);
-	printf("\tdisk writes: %d\n",d->nwrites);
+	struct disk_stats s;
+	disk_get_stats(d, &s);
+
+	printf("\tdisk reads: %"PRId64"\n",s.nreads);
+	printf("\tdisk writes: %"PRId64"\n",s.nwrites);
+	printf("\twrite amplification: %.2f\n",s.write_amplification);
+	printf("\tgc runs: %"PRId64", pages migrated: %"PRId64"\n",s.gc_runs,s.gc_pages_migrated);
+	printf("\tfree pages: %"PRId64" of %"PRId64"\n",s.free_pages,s.flash_pages);
+	printf("\tblock erases: %"PRIu32" to %"PRIu32"\n",s.erase_min,s.erase_max);
+	printf("\tprefetched pages: %"PRId64"\n",s.prefetched);
+	printf("\tprefetch hits: %"PRId64"\n",s.prefetch_hits);
+	printf("\tprefetch waste: %"PRId64"\n",s.prefetch_wasted);
+	io_sched_report(d->io);
+}
+
+/*
+Finish outstanding work and free the flash translation layer.
+*/
+
+void disk_close( struct disk *d )
+{
+	//abandon queued prefetches, then finish queued GC before the tables go away
+	for (int i = 0; i < RA_STREAMS; i++) {
+		ra_drop(d, &d->streams[i]);
+	}
+	io_sched_delete(d->io);
+	d->io = NULL;
+
+	disk_free(d);
+}
 
-	//free alloc mem
-	free(d->block_to_page);
+//free alloc mem, tolerating a partially constructed disk
+void disk_free(struct disk *d) {
+    if (d->io) io_sched_delete(d->io);
+    for (int i = 0; i < RA_STREAMS; i++) {
+        free(d->streams[i].staged);
+    }
+    free(d->block_to_page);
     free(d->page_to_block);
     free(d->page_status);
     free(d->erase_count);
+    free(d->block_free);
+    free(d->block_invalid);
+    free(d->free_heap);
+    free(d->heap_pos);
+    free(d->invalid_head);
+    free(d->invalid_next);
+    free(d->invalid_prev);
     free(d);
 }
 
 //clean a blk by moving valid pages and erasing
-void clean_block(struct disk *d, int block_num) {
+void clean_block(struct disk *d, int64_t block_num) {
 
-    int block_start = block_num * d->pages_per_block;
+    int64_t block_start = block_num * d->pages_per_block;
+    d->gc_runs++;
     // char buffer[DISK_BLOCK_SIZE];
     // printf("\n[clean_block] Cleaning block %d\n", block_num);
     
-    // record valid page info before erase
+    // record valid page info for pages that can't be copied out before erase,
+    // allocated only once copy-back fails since each entry holds a whole page
     struct {
-        int page_num;
-        int disk_block;
+        int64_t page_num;
+        int64_t disk_block;
         char data[DISK_BLOCK_SIZE];  
-    } valid_pages[d->pages_per_block];
+    } *valid_pages = NULL;
     
     int valid_count = 0;
 
-    // identify and store valid pages before erasing the block
+    // relocate valid pages before erasing the block
     for (int p = 0; p < d->pages_per_block; p++) {
-        int page_num = block_start + p;
+        int64_t page_num = block_start + p;
 
         // check if the page is contains data
         if (d->page_status[page_num] == PAGE_VALID) {
-            int disk_block = d->page_to_block[page_num];
-            if (disk_block >= 0) { // read to preserve data
-                flash_read(d->flash_drive, page_num, valid_pages[valid_count].data); 
-                valid_pages[valid_count].page_num = page_num;
-                valid_pages[valid_count].disk_block = disk_block;
-                valid_count++;
-                // printf("  [Migrate] Valid page %d still mapped to disk block %d\n", page_num, disk_block);
+            int64_t disk_block = get_block(d, page_num);
+            if (disk_block < 0) continue;
+
+            // copy-back into a free page of another block, no host buffer needed
+            int64_t new_page = find_free_page(d, block_num);
+            if (new_page >= 0) {
+                ftl_copy(d, IO_GC_MIGRATE, page_num, new_page);
+                d->gc_migrated++;
+                set_page(d, disk_block, new_page);
+                set_block(d, new_page, disk_block);
+                set_status(d, new_page, PAGE_VALID);
+                set_status(d, page_num, PAGE_INVALID);
+                set_block(d, page_num, -1);
+                continue;
             }
+
+            // no room elsewhere: read to preserve data
+            if (valid_pages == NULL) {
+                valid_pages = malloc(sizeof(*valid_pages) * d->pages_per_block);
+                if (valid_pages == NULL) {
+                    // pages copied out so far are already remapped, leave the rest in place
+                    fprintf(stderr, "  ERROR: No memory to stage block %"PRId64" for cleaning!\n", block_num);
+                    return;
+                }
+            }
+            ftl_read(d, IO_GC_MIGRATE, page_num, valid_pages[valid_count].data); 
+            valid_pages[valid_count].page_num = page_num;
+            valid_pages[valid_count].disk_block = disk_block;
+            valid_count++;
+            // printf("  [Migrate] Valid page %d still mapped to disk block %d\n", page_num, disk_block);
         }
     }
 
     // erase the block: mark all pages invalid and clear mappings
     for (int p = 0; p < d->pages_per_block; p++) {
-        int page_num = block_start + p;
-        d->page_status[page_num] = PAGE_INVALID;
-        d->page_to_block[page_num] = -1;
+        int64_t page_num = block_start + p;
+        set_status(d, page_num, PAGE_INVALID);
+        set_block(d, page_num, -1);
     }
     
     // do flash erase on the block
-    flash_erase(d->flash_drive, block_num);
-    d->erase_count[block_num]++;
+    ftl_erase(d, IO_GC_ERASE, block_num);
     // printf("  [Erase] Block %d erased (erase count now %d)\n", block_num, d->erase_count[block_num]);
 
     // mark all pages as free after erase
     for (int p = 0; p < d->pages_per_block; p++) {
-        int page_num = block_start + p;
-        d->page_status[page_num] = PAGE_FREE;
-        d->page_to_block[page_num] = -1;
+        int64_t page_num = block_start + p;
+        set_status(d, page_num, PAGE_FREE);
+        set_block(d, page_num, -1);
     }
+    block_erased(d, block_num);
 
-    // migrate valid pages to new free pages in this block or others
+    // migrate staged valid pages to new free pages in this block or others
     for (int i = 0; i < valid_count; i++) {
         // int old_page = valid_pages[i].page_num; // for debugging print later
-        int disk_block = valid_pages[i].disk_block;
+        int64_t disk_block = valid_pages[i].disk_block;
 
-        int new_page = find_free_page(d, -1); // find free page for migration allowing using this block
+        int64_t new_page = find_free_page(d, -1); // find free page for migration allowing using this block
         if (new_page >= 0) {
-            flash_write(d->flash_drive, new_page, valid_pages[i].data);
+            ftl_write(d, IO_GC_MIGRATE, new_page, valid_pages[i].data);
+            d->gc_migrated++;
 
             //update mappings
-            d->block_to_page[disk_block] = new_page;
-            d->page_to_block[new_page] = disk_block;
-            d->page_status[new_page] = PAGE_VALID;
+            set_page(d, disk_block, new_page);
+            set_block(d, new_page, disk_block);
+            set_status(d, new_page, PAGE_VALID);
 
             // printf("  [Remap] disk_block %d moved from old page %d to new page %d\n",
             //     disk_block, old_page, new_page);
@@ -293,71 +617,514 @@ void clean_block(struct disk *d, int block_num) {
             fprintf(stderr, "  ERROR: No free page available during cleaning (post-erase)!\n");
         }
     }
+    free(valid_pages);
+}
+
+
+
+//tables store index+1, translate to -1 for unmapped
+int64_t get_page(struct disk *d, int64_t disk_block) {
+    return (int64_t)d->block_to_page[disk_block] - 1;
 }
 
+void set_page(struct disk *d, int64_t disk_block, int64_t page) {
+    d->block_to_page[disk_block] = (uint32_t)(page + 1);
+}
 
+int64_t get_block(struct disk *d, int64_t page) {
+    return (int64_t)d->page_to_block[page] - 1;
+}
+
+void set_block(struct disk *d, int64_t page, int64_t disk_block) {
+    d->page_to_block[page] = (uint32_t)(disk_block + 1);
+}
+
+//change a page's status, keeping the free and invalid page counts up to date
+void set_status(struct disk *d, int64_t page, int status) {
+    int64_t b = page / d->pages_per_block;
+    int old_invalid = d->block_invalid[b];
+    if (d->page_status[page] == PAGE_FREE) {
+        d->block_free[b]--;
+        d->free_pages--;
+    } else if (d->page_status[page] == PAGE_INVALID) {
+        d->block_invalid[b]--;
+    }
+    if (status == PAGE_FREE) {
+        d->block_free[b]++;
+        d->free_pages++;
+    } else if (status == PAGE_INVALID) {
+        d->block_invalid[b]++;
+    }
+    d->page_status[page] = status;
+
+    // only blocks with invalid pages are listed as cleaning candidates
+    if (d->block_invalid[b] != old_invalid) {
+        if (old_invalid > 0) invalid_unlink(d, b, old_invalid);
+        if (d->block_invalid[b] > 0) invalid_link(d, b, d->block_invalid[b]);
+    }
+}
 
 // find a free page for writing
-int find_free_page(struct disk *d, int avoid_block) {
+int64_t find_free_page(struct disk *d, int64_t avoid_block) {
     if (d->flash_blocks == 0 || d->pages_per_block == 0) {
         fprintf(stderr, "ERROR: Invalid disk configuration (0 blocks or pages).\n");
         return -1;
     }
 
-    int best_page = -1;
-    int lowest_erase = INT_MAX;
+    // give up the open block once it is full or must be avoided
+    int64_t b = d->open_block;
+    if (b >= 0 && (b == avoid_block || d->block_free[b] == 0)) {
+        if (d->block_free[b] > 0) heap_push(d, b);
+        d->open_block = -1;
+    }
+
+    // open the block w lowest erase count, putting back the one to avoid
+    if (d->open_block < 0) {
+        if (d->heap_size == 0) return -1;
+        b = heap_pop(d);
+        if (b == avoid_block) {
+            int64_t next = d->heap_size > 0 ? heap_pop(d) : -1;
+            heap_push(d, b);
+            if (next < 0) return -1;
+            b = next;
+        }
+        d->open_block = b;
+    }
 
-    // iter over all flash blocks
-    for (int b = 0; b < d->flash_blocks; b++) {
-        if (b == avoid_block) continue;  // skip the block to avoid
+    // pages are only freed by erasing the whole block, so its free ones come last
+    return d->open_block * d->pages_per_block + (d->pages_per_block - d->block_free[d->open_block]);
+}
 
-        int block_start = b * d->pages_per_block;
+//count free pages outside of avoid_block, only in whole blocks like find_free_page
+int64_t count_free_pages(struct disk *d, int64_t avoid_block) {
+    if (avoid_block < 0) return d->free_pages;
+    return d->free_pages - d->block_free[avoid_block];
+}
 
-        // iter over all pages in the block
-        for (int p = 0; p < d->pages_per_block; p++) {
-            int page = block_start + p;
-
-            // check if the page is free
-            if (d->page_status[page] == PAGE_FREE) {
-                // track block w lowest erase count
-                if (d->erase_count[b] < lowest_erase) {
-                    lowest_erase = d->erase_count[b];
-                    best_page = page;
+//find blk to clean
+int64_t select_block_to_clean(struct disk *d) {
+    // the block heading the highest non-empty list has the most invalid pages
+    while (d->max_invalid > 0 && d->invalid_head[d->max_invalid] == 0) {
+        d->max_invalid--;
+    }
+
+    // only clean if at least one page is invalid
+    if (d->max_invalid == 0) {
+        return -1; // dont clean any block yet
+    }
+    return (int64_t)d->invalid_head[d->max_invalid] - 1;
+}
+
+//min-heap of blocks with free pages, ordered by erase count
+int heap_less(struct disk *d, int64_t i, int64_t j) {
+    return d->erase_count[d->free_heap[i]] < d->erase_count[d->free_heap[j]];
+}
+
+void heap_swap(struct disk *d, int64_t i, int64_t j) {
+    uint32_t t = d->free_heap[i];
+    d->free_heap[i] = d->free_heap[j];
+    d->free_heap[j] = t;
+    d->heap_pos[d->free_heap[i]] = (uint32_t)(i + 1);
+    d->heap_pos[d->free_heap[j]] = (uint32_t)(j + 1);
+}
+
+void heap_sift_up(struct disk *d, int64_t i) {
+    while (i > 0 && heap_less(d, i, (i - 1) / 2)) {
+        heap_swap(d, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void heap_sift_down(struct disk *d, int64_t i) {
+    for (;;) {
+        int64_t min = i;
+        int64_t l = 2 * i + 1;
+        int64_t r = 2 * i + 2;
+        if (l < d->heap_size && heap_less(d, l, min)) min = l;
+        if (r < d->heap_size && heap_less(d, r, min)) min = r;
+        if (min == i) return;
+        heap_swap(d, i, min);
+        i = min;
+    }
+}
+
+void heap_push(struct disk *d, int64_t block_num) {
+    int64_t i = d->heap_size++;
+    d->free_heap[i] = (uint32_t)block_num;
+    d->heap_pos[block_num] = (uint32_t)(i + 1);
+    heap_sift_up(d, i);
+}
+
+int64_t heap_pop(struct disk *d) {
+    int64_t block_num = d->free_heap[0];
+    heap_swap(d, 0, d->heap_size - 1);
+    d->heap_size--;
+    d->heap_pos[block_num] = 0;
+    heap_sift_down(d, 0);
+    return block_num;
+}
+
+//lists of blocks with the same number of invalid pages
+void invalid_link(struct disk *d, int64_t block_num, int count) {
+    uint32_t head = d->invalid_head[count];
+    d->invalid_next[block_num] = head;
+    d->invalid_prev[block_num] = 0;
+    if (head) d->invalid_prev[head - 1] = (uint32_t)(block_num + 1);
+    d->invalid_head[count] = (uint32_t)(block_num + 1);
+    if (count > d->max_invalid) d->max_invalid = count;
+}
+
+void invalid_unlink(struct disk *d, int64_t block_num, int count) {
+    uint32_t next = d->invalid_next[block_num];
+    uint32_t prev = d->invalid_prev[block_num];
+    if (prev) {
+        d->invalid_next[prev - 1] = next;
+    } else {
+        d->invalid_head[count] = next;
+    }
+    if (next) d->invalid_prev[next - 1] = prev;
+}
+
+//count an erase and make the block's pages available to find_free_page again
+void block_erased(struct disk *d, int64_t block_num) {
+    d->erase_count[block_num]++;
+    if (block_num == d->open_block) return;
+    if (d->heap_pos[block_num]) {
+        heap_sift_down(d, d->heap_pos[block_num] - 1); // its erase count only grew
+    } else {
+        heap_push(d, block_num);
+    }
+}
+
+//copy a staged block into data, returns 1 on a hit
+int ra_lookup(struct disk *d, int64_t disk_block, char *data) {
+    for (int i = 0; i < RA_STREAMS; i++) {
+        struct ra_stream *s = &d->streams[i];
+        for (int j = 0; j < s->nstaged; j++) {
+            if (s->staged_block[j] != disk_block) continue;
+
+            if (s->staged_state[j] == RA_READY) {
+                memcpy(data, s->staged + j * DISK_BLOCK_SIZE, DISK_BLOCK_SIZE);
+                s->staged_state[j] = RA_USED;
+                return 1;
+            }
+            // the demand read overtakes a queued prefetch, which then cancels itself
+            if (s->staged_state[j] == RA_PENDING) {
+                s->staged_state[j] = RA_USED;
+            }
+        }
+    }
+    return 0;
+}
+
+//discard a stream's staging buffer, counting pages read but never used
+void ra_drop(struct disk *d, struct ra_stream *s) {
+    for (int j = 0; j < s->nstaged; j++) {
+        if (s->staged_state[j] == RA_READY) {
+            d->ra_wasted++;
+        }
+    }
+    s->nstaged = 0;
+    s->gen++; // cancels prefetches still queued for the old window
+}
+
+//forget a staged copy of a block that is being overwritten
+void ra_invalidate(struct disk *d, int64_t disk_block) {
+    for (int i = 0; i < RA_STREAMS; i++) {
+        struct ra_stream *s = &d->streams[i];
+        for (int j = 0; j < s->nstaged; j++) {
+            if (s->staged_block[j] == disk_block) {
+                if (s->staged_state[j] == RA_READY) {
+                    d->ra_wasted++;
                 }
+                // mark consumed so the slot can't be hit again
+                s->staged_block[j] = -1;
+                s->staged_state[j] = RA_USED;
             }
         }
     }
+}
+
+//a queued prefetch into one staging slot
+struct ra_request {
+    struct io_request io;   //must be first, the scheduler only sees this
+    struct disk *d;
+    struct ra_stream *s;
+    int slot;
+    int gen;                //stream generation the slot belonged to when queued
+};
+
+//resolve the page at dispatch time, skip slots dropped or overtaken since queued
+int ra_prepare(struct io_request *r) {
+    struct ra_request *rr = (struct ra_request *)r;
+    struct ra_stream *s = rr->s;
+    if (rr->gen != s->gen || s->staged_state[rr->slot] != RA_PENDING) return 0;
+
+    r->page = get_page(rr->d, s->staged_block[rr->slot]);
+    if (r->page < 0) {
+        s->staged_state[rr->slot] = RA_USED;
+        return 0;
+    }
+    return 1;
+}
 
-    return best_page;  // -1 if no free pages found
+void ra_complete(struct io_request *r) {
+    struct ra_request *rr = (struct ra_request *)r;
+    if (!r->cancelled) {
+        rr->s->staged_state[rr->slot] = RA_READY;
+        rr->d->ra_prefetched++;
+    }
+    free(rr);
 }
 
-//find blk to clean
-int select_block_to_clean(struct disk *d) {
-    int best_block = -1;
-    int max_invalid = -1;
-    
-    // find block with most invalid pages
-    for (int b = 0; b < d->flash_blocks; b++) {
-        int invalid_count = 0;
-        int block_start = b * d->pages_per_block;
-        
-        for (int p = 0; p < d->pages_per_block; p++) {
-            if (d->page_status[block_start + p] == PAGE_INVALID) {
-                invalid_count++;
+//record a read in the stream table and prefetch ahead of established streams
+void ra_update(struct disk *d, int64_t disk_block) {
+    d->ra_clock++;
+
+    // reading the same block again neither breaks nor advances a stream
+    for (int i = 0; i < RA_STREAMS; i++) {
+        if (d->streams[i].last_block == disk_block) {
+            d->streams[i].age = d->ra_clock;
+            return;
+        }
+    }
+
+    // find the stream this read continues, or a nearby one still without a window
+    struct ra_stream *s = NULL;
+    struct ra_stream *near = NULL;
+    for (int i = 0; i < RA_STREAMS; i++) {
+        struct ra_stream *c = &d->streams[i];
+        if (c->last_block < 0) continue;
+
+        if (c->stride != 0 && disk_block == c->last_block + c->stride) {
+            s = c;
+            break;
+        }
+        int64_t delta = disk_block - c->last_block;
+        if (delta >= -RA_MAX_STRIDE && delta <= RA_MAX_STRIDE
+                && c->hits < RA_TRIGGER && near == NULL) {
+            near = c;
+        }
+    }
+
+    if (s != NULL) {
+        s->hits++;
+    } else if (near != NULL) {
+        // not established yet, so there is no read-ahead to lose
+        s = near;
+        s->stride = disk_block - s->last_block;
+        s->hits = 1;
+    } else {
+        // start a new stream in a free or least recently used slot
+        s = &d->streams[0];
+        for (int i = 1; i < RA_STREAMS; i++) {
+            if (d->streams[i].age < s->age) {
+                s = &d->streams[i];
             }
         }
-        
-        // choose blk with most invalid pages
-        if (invalid_count > max_invalid) {
-            max_invalid = invalid_count;
-            best_block = b;
+        ra_drop(d, s);
+        s->stride = 0;
+        s->hits = 0;
+    }
+    s->last_block = disk_block;
+    s->age = d->ra_clock;
+
+    if (s->hits < RA_TRIGGER) return;
+
+    // refill only once the staged window has been consumed
+    for (int j = 0; j < s->nstaged; j++) {
+        if (s->staged_state[j] != RA_USED) return;
+    }
+    ra_drop(d, s);
+
+    // queue the mapped pages among the next RA_WINDOW steps along the stride
+    for (int k = 1; k <= RA_WINDOW; k++) {
+        int64_t b = disk_block + k * s->stride;
+        if (b < 0 || b >= d->disk_blocks) break;
+        if (get_page(d, b) < 0) continue; // unwritten blocks read as zeros anyway
+
+        struct ra_request *rr = calloc(1, sizeof(*rr));
+        if (rr == NULL) break;
+
+        int slot = s->nstaged++;
+        s->staged_block[slot] = b;
+        s->staged_state[slot] = RA_PENDING;
+
+        rr->io.type = IO_READ;
+        rr->io.data = s->staged + slot * DISK_BLOCK_SIZE;
+        rr->io.prepare = ra_prepare;
+        rr->io.complete = ra_complete;
+        rr->d = d;
+        rr->s = s;
+        rr->slot = slot;
+        rr->gen = s->gen;
+        io_submit(d->io, IO_PREFETCH, &rr->io);
+    }
+}
+
+//synchronous flash operations, queued behind anything of higher priority
+void ftl_read(struct disk *d, enum io_class c, int64_t page, char *data) {
+    struct io_request r = { .type = IO_READ, .page = page, .data = data };
+    io_sync(d->io, c, &r);
+}
+
+void ftl_write(struct disk *d, enum io_class c, int64_t page, const char *data) {
+    struct io_request r = { .type = IO_WRITE, .page = page, .wdata = data };
+    io_sync(d->io, c, &r);
+}
+
+void ftl_copy(struct disk *d, enum io_class c, int64_t src_page, int64_t dst_page) {
+    struct io_request r = { .type = IO_COPY, .page = src_page, .dst_page = dst_page };
+    io_sync(d->io, c, &r);
+}
+
+void ftl_erase(struct disk *d, enum io_class c, int64_t block_num) {
+    struct io_request r = { .type = IO_ERASE, .page = block_num };
+    io_sync(d->io, c, &r);
+}
+
+//pick the copy destination at dispatch time, skip pages overwritten since queued
+int gc_prepare_copy(struct io_request *r) {
+    struct disk *d = r->arg;
+    if (d->page_status[r->page] != PAGE_VALID) return 0;
+
+    r->dst_page = find_free_page(d, d->gc_block);
+    if (r->dst_page < 0) {
+        fprintf(stderr, "  ERROR: No free page available for background migration!\n");
+        return 0;
+    }
+    return 1;
+}
+
+void gc_complete_copy(struct io_request *r) {
+    struct disk *d = r->arg;
+    if (!r->cancelled) {
+        int64_t disk_block = get_block(d, r->page);
+        set_status(d, r->page, PAGE_INVALID);
+        set_block(d, r->page, -1);
+        set_page(d, disk_block, r->dst_page);
+        set_block(d, r->dst_page, disk_block);
+        set_status(d, r->dst_page, PAGE_VALID);
+        d->gc_migrated++;
+    }
+    d->gc_pending--;
+    free(r);
+}
+
+//never erase a block that still holds live data
+int gc_prepare_erase(struct io_request *r) {
+    struct disk *d = r->arg;
+    int64_t block_start = d->gc_block * d->pages_per_block;
+    for (int p = 0; p < d->pages_per_block; p++) {
+        if (d->page_status[block_start + p] == PAGE_VALID) {
+            fprintf(stderr, "  ERROR: Block %"PRId64" still has valid pages, not erasing!\n", d->gc_block);
+            return 0;
         }
     }
-    
-    // only clean if at least one page is invalid
-    if (max_invalid > 0) {
-        return best_block;
+    return 1;
+}
+
+void gc_complete_erase(struct io_request *r) {
+    struct disk *d = r->arg;
+    if (!r->cancelled) {
+        int64_t block_start = d->gc_block * d->pages_per_block;
+        for (int p = 0; p < d->pages_per_block; p++) {
+            set_status(d, block_start + p, PAGE_FREE);
+            set_block(d, block_start + p, -1);
+        }
+        block_erased(d, d->gc_block);
     }
-    
-    return -1; // dont clean any block yet
+    d->gc_block = -1;
+    free(r);
+}
+
+//queue migrations and an erase for block_num, returns 0 if there is no room to copy out or no memory for the requests
+int gc_start(struct disk *d, int64_t block_num) {
+    int64_t block_start = block_num * d->pages_per_block;
+    int valid_count = 0;
+    for (int p = 0; p < d->pages_per_block; p++) {
+        if (d->page_status[block_start + p] == PAGE_VALID) {
+            valid_count++;
+        }
+    }
+
+    // each migration needs a free page outside the block, plus one for the pending host write
+    if (count_free_pages(d, block_num) <= valid_count) return 0;
+
+    // allocate every request first so a failure leaves nothing half queued
+    struct io_request *reqs[valid_count + 1];
+    for (int i = 0; i <= valid_count; i++) {
+        reqs[i] = calloc(1, sizeof(*reqs[i]));
+        if (reqs[i] == NULL) {
+            while (i-- > 0) free(reqs[i]);
+            return 0;
+        }
+    }
+
+    d->gc_block = block_num;
+    d->gc_runs++;
+    int n = 0;
+    for (int p = 0; p < d->pages_per_block; p++) {
+        if (d->page_status[block_start + p] != PAGE_VALID) continue;
+
+        struct io_request *r = reqs[n++];
+        r->type = IO_COPY;
+        r->page = block_start + p;
+        r->prepare = gc_prepare_copy;
+        r->complete = gc_complete_copy;
+        r->arg = d;
+        io_submit(d->io, IO_GC_MIGRATE, r);
+        d->gc_pending++;
+    }
+
+    struct io_request *r = reqs[n];
+    r->type = IO_ERASE;
+    r->page = block_num;
+    r->prepare = gc_prepare_erase;
+    r->complete = gc_complete_erase;
+    r->arg = d;
+    io_submit(d->io, IO_GC_ERASE, r);
+    return 1;
+}
+
+//run queued GC to completion
+void gc_finish(struct disk *d) {
+    while (d->gc_block >= 0 && io_dispatch(d->io)) {}
+}
+
+//write a line of JSON statistics every stats_interval host operations
+void stats_tick(struct disk *d) {
+    if (d->stats_out == NULL) return;
+    if ((d->nreads + d->nwrites) % d->stats_interval != 0) return;
+
+    struct disk_stats s;
+    struct flash_stats f;
+    disk_get_stats(d, &s);
+    flash_get_stats(d->flash_drive, &f);
+
+    FILE *out = d->stats_out;
+    fprintf(out, "{\"disk\":{\"reads\":%"PRId64",\"writes\":%"PRId64",\"read_us\":%"PRId64",\"write_us\":%"PRId64,
+            s.nreads, s.nwrites, s.read_us, s.write_us);
+    fprintf(out, ",\"gc_runs\":%"PRId64",\"gc_pages_migrated\":%"PRId64",\"write_amplification\":%.4f",
+            s.gc_runs, s.gc_pages_migrated, s.write_amplification);
+    fprintf(out, ",\"free_pages\":%"PRId64",\"flash_pages\":%"PRId64, s.free_pages, s.flash_pages);
+    fprintf(out, ",\"prefetched\":%"PRId64",\"prefetch_hits\":%"PRId64",\"prefetch_wasted\":%"PRId64,
+            s.prefetched, s.prefetch_hits, s.prefetch_wasted);
+    fprintf(out, ",\"erase_min\":%"PRIu32",\"erase_max\":%"PRIu32",\"erase_bucket_width\":%"PRIu32",\"erase_histogram\":[",
+            s.erase_min, s.erase_max, s.erase_bucket_width);
+    for (int i = 0; i < DISK_STATS_BUCKETS; i++) {
+        fprintf(out, "%s%"PRId64, i ? "," : "", s.erase_histogram[i]);
+    }
+    fprintf(out, "],\"queues\":[");
+    for (int c = 0; c < DISK_STATS_QUEUES; c++) {
+        fprintf(out, "%s{\"class\":\"%s\",\"depth\":%"PRId64",\"max_depth\":%"PRId64",\"dispatched\":%"PRId64",\"avg_wait_us\":%.1f}",
+                c ? "," : "", io_class_name(c), s.queues[c].depth, s.queues[c].max_depth,
+                s.queues[c].ndispatched, s.queues[c].avg_wait_us);
+    }
+    fprintf(out, "]},\"flash\":{\"reads\":%"PRId64",\"writes\":%"PRId64",\"erases\":%"PRId64",\"copies\":%"PRId64,
+            f.nreads, f.nwrites, f.nerases, f.ncopies);
+    fprintf(out, ",\"read_us\":%"PRId64",\"write_us\":%"PRId64",\"erase_us\":%"PRId64",\"copy_us\":%"PRId64,
+            f.read_us, f.write_us, f.erase_us, f.copy_us);
+    fprintf(out, ",\"most_writes\":%"PRIu32",\"least_writes\":%"PRIu32"}}\n", f.most_writes, f.least_writes);
+    fflush(out);
 }
@@ -9,18 +9,65 @@ You should read and understand it, but don't change it.
 
 #include "flash.h"
 
+#include <stdio.h>
+
 #define DISK_BLOCK_SIZE 4096
 
+/* Number of buckets in the erase count histogram of struct disk_stats. */
+#define DISK_STATS_BUCKETS 16
+
+/* Number of I/O scheduler queues in struct disk_stats, highest priority first:
+host read, host write, gc migrate, gc erase and prefetch. */
+#define DISK_STATS_QUEUES 5
+
+/* Counters of one I/O scheduler queue. */
+struct disk_queue_stats {
+	int64_t depth;                  /* requests waiting now */
+	int64_t max_depth;
+	int64_t ndispatched;            /* requests dispatched, including cancelled prefetches */
+	double avg_wait_us;             /* average time a dispatched request waited */
+};
+
+/* A snapshot of the flash translation layer counters, see disk_get_stats. */
+struct disk_stats {
+	int64_t nreads;                 /* host reads and writes */
+	int64_t nwrites;
+	int64_t read_us;                /* time spent in disk_read and disk_write */
+	int64_t write_us;
+	int64_t gc_runs;                /* blocks chosen for cleaning */
+	int64_t gc_pages_migrated;      /* valid pages moved by cleaning */
+	double write_amplification;     /* flash pages programmed per host write */
+	int64_t free_pages;
+	int64_t flash_pages;
+	int64_t prefetched;
+	int64_t prefetch_hits;
+	int64_t prefetch_wasted;
+	uint32_t erase_min;             /* erase counts across all flash blocks */
+	uint32_t erase_max;
+	uint32_t erase_bucket_width;    /* bucket i counts blocks erased erase_min+i*width up to erase_min+(i+1)*width-1 times */
+	int64_t erase_histogram[DISK_STATS_BUCKETS];
+	struct disk_queue_stats queues[DISK_STATS_QUEUES];
+};
+
 /* Create a new flash translation layer on top of flash drive f, simulating # disk_blocks */
-struct disk * disk_create( struct flash_drive *f, int disk_blocks );
+struct disk * disk_create( struct flash_drive *f, int64_t disk_blocks );
 
 /* Read exactly DISK_BLOCK_SIZE bytes from the given disk block */
-int  disk_read( struct disk *d, int disk_block, char *data );
+int  disk_read( struct disk *d, int64_t disk_block, char *data );
 
 /* Write exactly DISK_BLOCK_SIZE bytes to the given disk block */
-int  disk_write( struct disk *d, int disk_block, const char *data );
+int  disk_write( struct disk *d, int64_t disk_block, const char *data );
+
+/* Fill in a snapshot of the disk counters. May be called at any time. */
+void disk_get_stats( struct disk *d, struct disk_stats *s );
+
+/* Write disk and flash statistics as one line of JSON to out every ops host operations. Zero ops turns it off. */
+void disk_set_stats_interval( struct disk *d, FILE *out, int64_t ops );
+
+/* Finish background garbage collection queued by earlier writes. */
+void disk_flush( struct disk *d );
 
-/* Report the total number of operations done on the disk. */
+/* Report the total number of operations done on the disk. Does not touch the flash drive. */
 void disk_report( struct disk *d );
 
 /* Close the flash translation layer. */
@@ -5,35 +5,106 @@ Do not change this file.
 */
 
 #define _XOPEN_SOURCE 500L
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
 
 #include "flash.h"
 
 #include <unistd.h>
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/time.h>
 
 #define ABS(x) ( (x)<(0) ? -(x) : (x) )
 
+/* copy_file_range copies inside the backing file without a user buffer */
+#if defined(__GLIBC__) && (__GLIBC__>2 || (__GLIBC__==2 && __GLIBC_MINOR__>=27))
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+
+
 struct flash_drive {
 	int fd;
-	int npages;
+	int64_t npages;
 	int page_size;
 	int npages_per_block;
-	int nreads;
-	int nwrites;
-	int nerases;
+	int64_t nreads;
+	int64_t nwrites;
+	int64_t nerases;
+	int64_t ncopies;
+	int64_t read_us;
+	int64_t write_us;
+	int64_t erase_us;
+	int64_t copy_us;
 	int threads_inside;
-	int *page_status;
-	int *page_writes;
+	unsigned char *page_status;
+	uint32_t *page_writes;
+	int64_t most_written_page;
+	uint32_t most_writes;
+	int64_t least_written_page;   /* lowest numbered page with the fewest writes */
+	uint32_t least_writes;
+	char *copy_buffer;          /* used by flash_copy when the kernel can't copy for it */
+	int copy_in_kernel;         /* cleared once copy_file_range fails */
 };
 
-struct flash_drive * flash_create( const char *flashname, int npages, int npages_per_block )
+/*
+Count a write to page, keeping the most and least written pages current.
+Write counts only grow by one, so the least written page moves forward
+and wraps around once every page has been written again, which costs
+one pass over page_writes per least_writes level instead of one per call.
+*/
+static void flash_count_write( struct flash_drive *d, int64_t page )
+{
+	d->page_writes[page]++;
+	if(d->page_writes[page]>d->most_writes) {
+		d->most_written_page = page;
+		d->most_writes = d->page_writes[page];
+	}
+
+	while(d->page_writes[d->least_written_page]>d->least_writes) {
+		d->least_written_page++;
+		if(d->least_written_page==d->npages) {
+			d->least_written_page = 0;
+			d->least_writes++;
+		}
+	}
+}
+
+/*
+Copy a page inside the backing file without reading it into user memory.
+Returns 0 if the kernel can't, and then the caller reads and writes it.
+*/
+static int flash_copy_range( struct flash_drive *d, int64_t src_page, int64_t dst_page )
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	off_t src = (off_t)src_page*d->page_size;
+	off_t dst = (off_t)dst_page*d->page_size;
+	size_t left = d->page_size;
+
+	while(d->copy_in_kernel && left>0) {
+		ssize_t actual = copy_file_range(d->fd,&src,d->fd,&dst,left,0);
+		if(actual<=0) {
+			d->copy_in_kernel = 0;
+			return 0;
+		}
+		left -= actual;
+	}
+	return left==0;
+#else
+	return 0;
+#endif
+}
+
+struct flash_drive * flash_create( const char *flashname, int64_t npages, int npages_per_block )
 {
 	struct flash_drive *d;
 
+	if(npages<=0 || npages_per_block<=0) return 0;
+
 	d = malloc(sizeof(*d));
 	if(!d) return 0;
 
@@ -49,10 +120,34 @@ struct flash_drive * flash_create( const char *flashname, int npages, int npages
 	d->threads_inside = 0;
 	d->nreads = 0;
 	d->nwrites = 0;
-	d->page_status = calloc(1,sizeof(int)*d->npages);
-	d->page_writes = calloc(1,sizeof(int)*d->npages);
+	d->nerases = 0;
+	d->ncopies = 0;
+	d->read_us = 0;
+	d->write_us = 0;
+	d->erase_us = 0;
+	d->copy_us = 0;
+	d->most_written_page = 0;
+	d->most_writes = 0;
+	d->least_written_page = 0;
+	d->least_writes = 0;
+	d->copy_in_kernel = 1;
+	d->page_status = calloc(d->npages,sizeof(*d->page_status));
+	d->page_writes = calloc(d->npages,sizeof(*d->page_writes));
+	d->copy_buffer = malloc(d->page_size);
+
+	if(!d->page_status || !d->page_writes || !d->copy_buffer) {
+		free(d->page_status);
+		free(d->page_writes);
+		free(d->copy_buffer);
+		close(d->fd);
+		free(d);
+		return 0;
+	}
 	
-	if(ftruncate(d->fd,d->npages*d->page_size)<0) {
+	if(ftruncate(d->fd,(off_t)d->npages*d->page_size)<0) {
+		free(d->page_status);
+		free(d->page_writes);
+		free(d->copy_buffer);
 		close(d->fd);
 		free(d);
 		return 0;
@@ -61,8 +156,9 @@ struct flash_drive * flash_create( const char *flashname, int npages, int npages
 	return d;
 }
 
-void flash_write( struct flash_drive *d, int page, const char *data )
+void flash_write( struct flash_drive *d, int64_t page, const char *data )
 {
+	int64_t start = flash_now_us();
 	d->threads_inside++;
 	
 	if(d->threads_inside>1) {
@@ -71,36 +167,88 @@ void flash_write( struct flash_drive *d, int page, const char *data )
 	}
 	
 	if(page<0 || page>=d->npages) {
-		fprintf(stderr,"flash_write: CRASH: invalid page #%d\n",page);
+		fprintf(stderr,"flash_write: CRASH: invalid page #%"PRId64"\n",page);
 		abort();
 	}
 
 	if(d->page_status[page]) {
-		fprintf(stderr,"flash_write: CRASH: page #%d written twice without erasing first.\n",page);
+		fprintf(stderr,"flash_write: CRASH: page #%"PRId64" written twice without erasing first.\n",page);
 		abort();
 	}
 	
-	printf("flash_write: page %d\n",page);
+	printf("flash_write: page %"PRId64"\n",page);
 
 	usleep(200);
 	
-	int actual = pwrite(d->fd,(char*)data,d->page_size,page*d->page_size);
+	int actual = pwrite(d->fd,(char*)data,d->page_size,(off_t)page*d->page_size);
 	if(actual!=d->page_size) {
-		fprintf(stderr,"flash_write: CRASH: failed to write page #%d: %s\n",page,strerror(errno));
+		fprintf(stderr,"flash_write: CRASH: failed to write page #%"PRId64": %s\n",page,strerror(errno));
 		abort();
 	}
 
 	d->page_status[page] = 1;
-	d->page_writes[page]++;
+	flash_count_write(d,page);
 	d->threads_inside--;
 	d->nwrites++;
+	d->write_us += flash_now_us() - start;
+}
+
+void flash_copy( struct flash_drive *d, int64_t src_page, int64_t dst_page )
+{
+	int64_t start = flash_now_us();
+	d->threads_inside++;
+
+	if(d->threads_inside>1) {
+		fprintf(stderr,"flash_copy: CRASH: multiple threads in flash drive at once!\n");
+		abort();
+	}
+
+	if(src_page<0 || src_page>=d->npages) {
+		fprintf(stderr,"flash_copy: CRASH: invalid source page #%"PRId64"\n",src_page);
+		abort();
+	}
+
+	if(dst_page<0 || dst_page>=d->npages) {
+		fprintf(stderr,"flash_copy: CRASH: invalid destination page #%"PRId64"\n",dst_page);
+		abort();
+	}
+
+	if(d->page_status[dst_page]) {
+		fprintf(stderr,"flash_copy: CRASH: page #%"PRId64" written twice without erasing first.\n",dst_page);
+		abort();
+	}
+
+	printf("flash_copy: page %"PRId64" to page %"PRId64"\n",src_page,dst_page);
+
+	usleep(220);
+
+	if(!flash_copy_range(d,src_page,dst_page)) {
+		int actual = pread(d->fd,d->copy_buffer,d->page_size,(off_t)src_page*d->page_size);
+		if(actual!=d->page_size) {
+			fprintf(stderr,"flash_copy: CRASH: failed to read page #%"PRId64": %s\n",src_page,strerror(errno));
+			abort();
+		}
+
+		actual = pwrite(d->fd,d->copy_buffer,d->page_size,(off_t)dst_page*d->page_size);
+		if(actual!=d->page_size) {
+			fprintf(stderr,"flash_copy: CRASH: failed to write page #%"PRId64": %s\n",dst_page,strerror(errno));
+			abort();
+		}
+	}
+
+	d->page_status[dst_page] = 1;
+	flash_count_write(d,dst_page);
+	d->threads_inside--;
+	d->ncopies++;
+	d->copy_us += flash_now_us() - start;
 }
 
-void flash_erase( struct flash_drive *d, int block )
+void flash_erase( struct flash_drive *d, int64_t block )
 {
+	int64_t start = flash_now_us();
 	d->threads_inside++;
 
-	int page = block * d->npages_per_block;
+	int64_t page = block * d->npages_per_block;
 	
 	if(d->threads_inside>1) {
 		fprintf(stderr,"flash_erase: CRASH: multiple threads in flash drive at once!\n");
@@ -108,16 +256,16 @@ void flash_erase( struct flash_drive *d, int block )
 	}
 	
 	if(page<0 || page>=d->npages) {
-		fprintf(stderr,"flash_write: CRASH: invalid page #%d\n",page);
+		fprintf(stderr,"flash_write: CRASH: invalid page #%"PRId64"\n",page);
 		abort();
 	}
 
 	if(page % d->npages_per_block!=0) {
-		fprintf(stderr,"flash_write: CRASH: invalid starting page (%d) for erase operation",page);
+		fprintf(stderr,"flash_write: CRASH: invalid starting page (%"PRId64") for erase operation",page);
 		abort();
 	}
 	
-	printf("flash_erase: page %d through %d\n",page,page+d->npages_per_block-1);
+	printf("flash_erase: page %"PRId64" through %"PRId64"\n",page,page+d->npages_per_block-1);
 
 	usleep(500);
 
@@ -125,9 +273,9 @@ void flash_erase( struct flash_drive *d, int block )
 	
 	char *data = calloc(1,block_length);
 	
-	int actual = pwrite(d->fd,(char*)data,block_length,page*d->page_size);
+	int actual = pwrite(d->fd,(char*)data,block_length,(off_t)page*d->page_size);
 	if(actual!=block_length) {
-		fprintf(stderr,"flash_write: CRASH: failed to erase page #%d: %s\n",page,strerror(errno));
+		fprintf(stderr,"flash_write: CRASH: failed to erase page #%"PRId64": %s\n",page,strerror(errno));
 		abort();
 	}
 
@@ -139,10 +287,12 @@ void flash_erase( struct flash_drive *d, int block )
 	
 	d->threads_inside--;
 	d->nerases++;
+	d->erase_us += flash_now_us() - start;
 }
 
-void flash_read( struct flash_drive *d, int page, char *data )
+void flash_read( struct flash_drive *d, int64_t page, char *data )
 {
+	int64_t start = flash_now_us();
 	d->threads_inside++;
 
 	if(d->threads_inside>1) {
@@ -151,25 +301,33 @@ void flash_read( struct flash_drive *d, int page, char *data )
 	}
 	
 	if(page<0 || page>=d->npages) {
-		fprintf(stderr,"flash_read: CRASH: invalid page #%d\n",page);
+		fprintf(stderr,"flash_read: CRASH: invalid page #%"PRId64"\n",page);
 		abort();
 	}
 
-	printf("flash_read: page %d\n",page);
+	printf("flash_read: page %"PRId64"\n",page);
 	
 	usleep(50);
 	
-	int actual = pread(d->fd,(char*)data,d->page_size,page*d->page_size);
+	int actual = pread(d->fd,(char*)data,d->page_size,(off_t)page*d->page_size);
 	if(actual!=d->page_size) {
-		fprintf(stderr,"flash_read: CRASH: failed to read page #%d: %s\n",page,strerror(errno));
+		fprintf(stderr,"flash_read: CRASH: failed to read page #%"PRId64": %s\n",page,strerror(errno));
 		abort();
 	}
 
 	d->threads_inside--;
 	d->nreads++;
+	d->read_us += flash_now_us() - start;
 }
 
-int flash_npages( struct flash_drive *d )
+int64_t flash_now_us( void )
+{
+	struct timeval tv;
+	gettimeofday(&tv,0);
+	return (int64_t)tv.tv_sec*1000000 + tv.tv_usec;
+}
+
+int64_t flash_npages( struct flash_drive *d )
 {
 	return d->npages;
 }
@@ -179,45 +337,52 @@ int flash_npages_per_block( struct flash_drive *d )
 	return d->npages_per_block;
 }
 
-void flash_report( struct flash_drive *d )
+void flash_get_stats( struct flash_drive *d, struct flash_stats *s )
 {
-	printf("\tflash  reads: %d\n",d->nreads);
-	printf("\tflash writes: %d\n",d->nwrites);
-	printf("\tflash erases: %d\n",d->nerases);
+	s->npages = d->npages;
+	s->npages_per_block = d->npages_per_block;
+	s->nreads = d->nreads;
+	s->nwrites = d->nwrites;
+	s->nerases = d->nerases;
+	s->ncopies = d->ncopies;
+	s->read_us = d->read_us;
+	s->write_us = d->write_us;
+	s->erase_us = d->erase_us;
+	s->copy_us = d->copy_us;
+	s->most_written_page = d->most_written_page;
+	s->most_writes = d->most_writes;
+	s->least_written_page = d->least_written_page;
+	s->least_writes = d->least_writes;
+}
 
-	int max_page = 0;
-	int max_writes = d->page_writes[0];
+void flash_report( struct flash_drive *d )
+{
+	struct flash_stats s;
+	flash_get_stats(d,&s);
 
-	int min_page = 0;
-	int min_writes = max_writes;
-	
-	for(int i=1;i<d->npages;i++) {
-		if(d->page_writes[i]>max_writes) {
-			max_page = i;
-			max_writes = d->page_writes[i];
-		}
-		if(d->page_writes[i]<min_writes) {
-			min_page = i;
-			min_writes = d->page_writes[i];
-		}
-	}
+	printf("\tflash  reads: %"PRId64"\n",s.nreads);
+	printf("\tflash writes: %"PRId64"\n",s.nwrites);
+	printf("\tflash erases: %"PRId64"\n",s.nerases);
+	printf("\tflash copies: %"PRId64"\n",s.ncopies);
 
 	printf("\twear differential:\n");
-	printf("\tmost written:  page %d was written %d times\n",max_page,max_writes);
-	printf("\tleast written: page %d was written %d times\n",min_page,min_writes);
+	printf("\tmost written:  page %"PRId64" was written %"PRIu32" times\n",s.most_written_page,s.most_writes);
+	printf("\tleast written: page %"PRId64" was written %"PRIu32" times\n",s.least_written_page,s.least_writes);
 
 		
 	printf("\tratio of most/least: ");
-	if(min_writes==0) {
+	if(s.least_writes==0) {
 		printf("infinite!\n");
 	} else {
-		printf("%.2lf\n",(double)max_writes/min_writes);
+		printf("%.2lf\n",(double)s.most_writes/s.least_writes);
 	}		
 }
 
 void flash_close( struct flash_drive *d )
 {
 	free(d->page_status);
+	free(d->page_writes);
+	free(d->copy_buffer);
 	close(d->fd);
 	free(d);
 }
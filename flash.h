@@ -7,29 +7,62 @@ Do not change this file.
 #ifndef FLASH_H
 #define FLASH_H
 
+#include <stdint.h>
+
 #define FLASH_PAGE_SIZE 4096
 
 /*
 Create a new virtual flash drive in the file "filename", with the given number of pages.
+Page and block numbers are 64 bits wide, so devices may be larger than 2 GiB.
 Returns a pointer to a new flash drive object, or null on failure.
 */
-struct flash_drive * flash_create( const char *filename, int flash_pages, int flash_pages_per_block );
+struct flash_drive * flash_create( const char *filename, int64_t flash_pages, int flash_pages_per_block );
 
 /* Write exactly FLASH_PAGE_SIZE bytes to a given page on the device. */
-void flash_write( struct flash_drive *d, int flash_page, const char *data );
+void flash_write( struct flash_drive *d, int64_t flash_page, const char *data );
 
 /* Read exactly FLASH_PAGE_SIZE bytes from a given page on the device. */
-void flash_read( struct flash_drive *d, int flash_page, char *data );
+void flash_read( struct flash_drive *d, int64_t flash_page, char *data );
+
+/*
+Copy one page to another erased page inside the device, without transferring
+the data to the caller. Costs less than a separate read and write.
+*/
+void flash_copy( struct flash_drive *d, int64_t src_page, int64_t dst_page );
 
 /* Erase an entire block of pages.  */
-void flash_erase( struct flash_drive *d, int flash_block );
+void flash_erase( struct flash_drive *d, int64_t flash_block );
 
 /* Return the number of pages in this device. */
-int flash_npages( struct flash_drive *d );
+int64_t flash_npages( struct flash_drive *d );
 
 /* Return the number of pages per block in this device. */
 int flash_npages_per_block( struct flash_drive *d );
 
+/* A snapshot of the device counters, see flash_get_stats. */
+struct flash_stats {
+	int64_t npages;
+	int npages_per_block;
+	int64_t nreads;
+	int64_t nwrites;
+	int64_t nerases;
+	int64_t ncopies;
+	int64_t read_us;            /* time spent in each kind of operation */
+	int64_t write_us;
+	int64_t erase_us;
+	int64_t copy_us;
+	int64_t most_written_page;
+	uint32_t most_writes;
+	int64_t least_written_page;
+	uint32_t least_writes;
+};
+
+/* Fill in a snapshot of the device counters. May be called at any time. */
+void flash_get_stats( struct flash_drive *d, struct flash_stats *s );
+
+/* Return the microsecond clock used to time flash operations. */
+int64_t flash_now_us( void );
+
 /* Print a report of total operations performed. */
 void flash_report( struct flash_drive *d );
 
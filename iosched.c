@@ -0,0 +1,165 @@
+/*
+I/O scheduler between the flash translation layer and the flash drive.
+*/
+
+#include "iosched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+struct io_queue {
+	struct io_request *head;
+	struct io_request *tail;
+	int64_t depth;
+	int64_t max_depth;
+	int64_t ndispatched;
+	int64_t total_wait_us;
+};
+
+struct io_sched {
+	struct flash_drive *flash_drive;
+	struct io_queue queues[IO_NCLASSES];
+};
+
+static const char *io_class_names[IO_NCLASSES] = {
+	"host read",
+	"host write",
+	"gc migrate",
+	"gc erase",
+	"prefetch",
+};
+
+struct io_sched * io_sched_create( struct flash_drive *f )
+{
+	struct io_sched *s = calloc(1,sizeof(*s));
+	if(!s) return 0;
+
+	s->flash_drive = f;
+	return s;
+}
+
+void io_submit( struct io_sched *s, enum io_class c, struct io_request *r )
+{
+	struct io_queue *q = &s->queues[c];
+
+	r->done = 0;
+	r->cancelled = 0;
+	r->enqueue_us = flash_now_us();
+	r->next = 0;
+
+	if(q->tail) {
+		q->tail->next = r;
+	} else {
+		q->head = r;
+	}
+	q->tail = r;
+
+	q->depth++;
+	if(q->depth>q->max_depth) q->max_depth = q->depth;
+}
+
+static void io_dispatch_queue( struct io_sched *s, struct io_queue *q )
+{
+	struct io_request *r = q->head;
+
+	q->head = r->next;
+	if(!q->head) q->tail = 0;
+	q->depth--;
+
+	q->ndispatched++;
+	q->total_wait_us += flash_now_us() - r->enqueue_us;
+
+	if(r->prepare && !r->prepare(r)) {
+		r->cancelled = 1;
+	} else {
+		switch(r->type) {
+			case IO_READ:
+				flash_read(s->flash_drive,r->page,r->data);
+				break;
+			case IO_WRITE:
+				flash_write(s->flash_drive,r->page,r->wdata);
+				break;
+			case IO_COPY:
+				flash_copy(s->flash_drive,r->page,r->dst_page);
+				break;
+			case IO_ERASE:
+				flash_erase(s->flash_drive,r->page);
+				break;
+		}
+	}
+
+	/* complete may free r, so mark it done first */
+	r->done = 1;
+	if(r->complete) r->complete(r);
+}
+
+int io_dispatch( struct io_sched *s )
+{
+	for(int c=0;c<IO_NCLASSES;c++) {
+		if(s->queues[c].head) {
+			io_dispatch_queue(s,&s->queues[c]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void io_sync( struct io_sched *s, enum io_class c, struct io_request *r )
+{
+	io_submit(s,c,r);
+	while(!r->done) {
+		io_dispatch(s);
+	}
+}
+
+void io_background( struct io_sched *s, enum io_class c, int n )
+{
+	for(int i=0;i<n;i++) {
+		int k = c;
+		while(k<IO_NCLASSES && !s->queues[k].head) k++;
+		if(k==IO_NCLASSES) return;
+		io_dispatch_queue(s,&s->queues[k]);
+	}
+}
+
+int64_t io_depth( struct io_sched *s, enum io_class c )
+{
+	return s->queues[c].depth;
+}
+
+int64_t io_max_depth( struct io_sched *s, enum io_class c )
+{
+	return s->queues[c].max_depth;
+}
+
+int64_t io_ndispatched( struct io_sched *s, enum io_class c )
+{
+	return s->queues[c].ndispatched;
+}
+
+double io_avg_wait( struct io_sched *s, enum io_class c )
+{
+	struct io_queue *q = &s->queues[c];
+	if(q->ndispatched==0) return 0;
+	return (double)q->total_wait_us/q->ndispatched;
+}
+
+const char * io_class_name( enum io_class c )
+{
+	return io_class_names[c];
+}
+
+void io_sched_report( struct io_sched *s )
+{
+	for(int c=0;c<IO_NCLASSES;c++) {
+		struct io_queue *q = &s->queues[c];
+		printf("\t%-10s queue: %"PRId64" ops, avg wait %.1f us, depth %"PRId64", max depth %"PRId64"\n",io_class_names[c],q->ndispatched,io_avg_wait(s,c),q->depth,q->max_depth);
+	}
+}
+
+void io_sched_delete( struct io_sched *s )
+{
+	while(io_dispatch(s)) {}
+	free(s);
+}
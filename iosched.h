@@ -0,0 +1,89 @@
+/*
+I/O scheduler between the flash translation layer and the flash drive.
+Every flash operation is queued by class and dispatched in strict priority
+order. Background GC is queued page by page and only advanced after host
+writes, so host reads do not wait on it. This does not cover the FTL's
+synchronous clean_block fallback, used when there is no room to copy a
+victim block's pages out. That runs a whole block clean inside one
+disk_write, as it does on nearly full geometries.
+*/
+
+#ifndef IOSCHED_H
+#define IOSCHED_H
+
+#include "flash.h"
+
+/* Queues, highest priority first. */
+enum io_class {
+	IO_HOST_READ,
+	IO_HOST_WRITE,
+	IO_GC_MIGRATE,
+	IO_GC_ERASE,
+	IO_PREFETCH,
+	IO_NCLASSES
+};
+
+enum io_type {
+	IO_READ,
+	IO_WRITE,
+	IO_COPY,
+	IO_ERASE
+};
+
+/*
+A single flash operation. The caller owns the memory.
+prepare, if set, runs just before dispatch and may cancel the request by returning 0.
+complete, if set, runs after dispatch or cancellation and may free the request.
+*/
+struct io_request {
+	enum io_type type;
+	int64_t page;           /* page to read, write or copy from; block to erase */
+	int64_t dst_page;       /* destination page of a copy */
+	char *data;
+	const char *wdata;
+	int (*prepare)( struct io_request *r );
+	void (*complete)( struct io_request *r );
+	void *arg;              /* for use by the callbacks */
+	int done;
+	int cancelled;
+	int64_t enqueue_us;
+	struct io_request *next;
+};
+
+/* Create a scheduler for flash drive f. Returns null on failure. */
+struct io_sched * io_sched_create( struct flash_drive *f );
+
+/* Queue a request without dispatching it. */
+void io_submit( struct io_sched *s, enum io_class c, struct io_request *r );
+
+/* Queue a request and dispatch until it has completed. */
+void io_sync( struct io_sched *s, enum io_class c, struct io_request *r );
+
+/* Dispatch the highest priority queued request. Returns 0 if all queues are empty. */
+int io_dispatch( struct io_sched *s );
+
+/* Dispatch up to n requests from queue c and the queues below it, letting background work make progress. */
+void io_background( struct io_sched *s, enum io_class c, int n );
+
+/* Return the number of requests waiting in a queue. */
+int64_t io_depth( struct io_sched *s, enum io_class c );
+
+/* Return the most requests that have waited in a queue at once. */
+int64_t io_max_depth( struct io_sched *s, enum io_class c );
+
+/* Return the number of requests dispatched from a queue, including cancelled ones. */
+int64_t io_ndispatched( struct io_sched *s, enum io_class c );
+
+/* Return the average time in microseconds that dispatched requests waited in a queue. */
+double io_avg_wait( struct io_sched *s, enum io_class c );
+
+/* Return a printable name for a queue. */
+const char * io_class_name( enum io_class c );
+
+/* Print per-queue depth and wait statistics. */
+void io_sched_report( struct io_sched *s );
+
+/* Dispatch everything still queued and free the scheduler. */
+void io_sched_delete( struct io_sched *s );
+
+#endif
@@ -8,26 +8,28 @@ You should read and understand it, but don't change it.
 #include "flash.h"
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
 #include <sys/time.h>
 
-void do_sequential_write( struct disk *d, int nblocks );
-void do_random_readwrite( struct disk *d, int nblocks, int ops );
+void do_sequential_write( struct disk *d, int64_t nblocks );
+void do_random_readwrite( struct disk *d, int64_t nblocks, int ops );
 
 int main( int argc, char *argv[] )
 {
-	if(argc!=4) {
-		printf("use: %s <disk-blocks> <flash-pages> <pages-per-block>\n",argv[0]);
+	if(argc!=4 && argc!=5) {
+		printf("use: %s <disk-blocks> <flash-pages> <pages-per-block> [stats-interval]\n",argv[0]);
 		return 1;
 	}
 
 	/* Parse the command line arguments */
-	int disk_blocks = atoi(argv[1]);
-	int flash_pages = atoi(argv[2]);
+	int64_t disk_blocks = strtoll(argv[1],0,10);
+	int64_t flash_pages = strtoll(argv[2],0,10);
 	int flash_pages_per_block = atoi(argv[3]);
+	int64_t stats_interval = argc==5 ? strtoll(argv[4],0,10) : 0;
 	int total_ops = 10000;
 	const char *filename = "myvirtualflash";
 
@@ -35,7 +37,7 @@ int main( int argc, char *argv[] )
 	srand(time(0));
 
 	/* Create the underlying flash drive */
-	printf("Creating flash drive %s with %d flash pages and %d flash blocks\n",filename,flash_pages,flash_pages/flash_pages_per_block);
+	printf("Creating flash drive %s with %"PRId64" flash pages and %"PRId64" flash blocks\n",filename,flash_pages,flash_pages/flash_pages_per_block);
 	struct flash_drive *theflash = flash_create(filename,flash_pages,flash_pages_per_block);
 	if(!theflash) {
 		printf("couldn't open %s: %s\n",filename,strerror(errno));
@@ -45,17 +47,29 @@ int main( int argc, char *argv[] )
 	/* Then create the flash translation layer around it. */
 	printf("Creating flash translation layer...\n");
 	struct disk *thedisk = disk_create(theflash,disk_blocks);
+	if(!thedisk) {
+		printf("couldn't create flash translation layer\n");
+		flash_close(theflash);
+		return 1;
+	}
+
+	/* Optionally stream statistics as JSON lines on stderr while running. */
+	disk_set_stats_interval(thedisk,stderr,stats_interval);
 
 	/* Run the simulation */
 	printf("Running %d I/O operations...\n",total_ops);
 	do_sequential_write(thedisk,disk_blocks);
 	do_random_readwrite(thedisk,disk_blocks,total_ops);
 
+	/* Finish queued GC so the report covers all the work the device does. */
+	disk_flush(thedisk);
+
 	/* Display the key output values. */
 	printf("System Performance:\n");
 	disk_report(thedisk);
 	flash_report(theflash);
 	
+	disk_close(thedisk);
 	flash_close(theflash);
 	
 	return 0;
@@ -63,11 +77,11 @@ int main( int argc, char *argv[] )
 
 /* Write to every block in the disk to get started. */
 
-void do_sequential_write( struct disk *d, int nblocks )
+void do_sequential_write( struct disk *d, int64_t nblocks )
 {
 	char data[DISK_BLOCK_SIZE];
 
-	for(int i=0;i<nblocks;i++) {
+	for(int64_t i=0;i<nblocks;i++) {
 		memset(data,i%127,sizeof(data));
 		disk_write(d,i,data);
 	}
@@ -75,13 +89,15 @@ void do_sequential_write( struct disk *d, int nblocks )
 
 /* Read and write randomly from the disk 80 / 20 percent. */
 
-void do_random_readwrite( struct disk *d, int disk_blocks, int ops )
+void do_random_readwrite( struct disk *d, int64_t disk_blocks, int ops )
 {
 	char data[DISK_BLOCK_SIZE];
 
 	int i;
 	for(i=0;i<ops;i++) {
-		int block = rand()%disk_blocks;
+		/* combine two calls, rand alone stops at RAND_MAX */
+		uint64_t r = (uint64_t)rand()*((uint64_t)RAND_MAX+1) + (uint64_t)rand();
+		int64_t block = (int64_t)(r % (uint64_t)disk_blocks);
 		if(rand()%10>=8) {
 			memset(data,block%127,sizeof(data));
 			disk_write(d,block,data);
@@ -0,0 +1,104 @@
+/*
+Checks 64-bit addressing on a flash drive larger than 2 GiB.
+The drive file is sparse, so it takes almost no real disk space.
+*/
+
+#define _XOPEN_SOURCE 500L
+#define _FILE_OFFSET_BITS 64
+
+#include "disk.h"
+#include "flash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TEST_PAGES (INT64_C(1)<<20)   /* 4 GiB of 4 KiB pages */
+#define TEST_PAGES_PER_BLOCK 4            /* small blocks, so the FTL has many to search */
+#define TEST_TIMED_WRITES 1000
+#define TEST_MAX_FTL_US 50                /* a scan of every block takes several times this */
+
+int failures = 0;
+
+void check( int ok, const char *what )
+{
+	fprintf(stderr,"%s: %s\n",ok ? "PASS" : "FAIL",what);
+	if(!ok) failures++;
+}
+
+int main()
+{
+	const char *filename = "test_large_flash";
+	char data[FLASH_PAGE_SIZE];
+	char other[FLASH_PAGE_SIZE];
+	char zero[FLASH_PAGE_SIZE];
+	memset(zero,0,sizeof(zero));
+
+	struct flash_drive *f = flash_create(filename,TEST_PAGES,TEST_PAGES_PER_BLOCK);
+	check(f!=0,"create a 4 GiB flash drive");
+	if(!f) return 1;
+
+	struct stat info;
+	check(stat(filename,&info)==0 && info.st_size==(off_t)TEST_PAGES*FLASH_PAGE_SIZE,"backing file size is not truncated");
+
+	int64_t last = TEST_PAGES-1;
+	int64_t alias = last % (TEST_PAGES/2); /* where last would land with 32-bit offsets */
+
+	memset(data,0x5a,sizeof(data));
+	flash_write(f,last,data);
+	flash_read(f,last,other);
+	check(!memcmp(data,other,sizeof(data)),"write and read back the last page");
+
+	flash_read(f,alias,other);
+	check(!memcmp(zero,other,sizeof(zero)),"last page does not alias a low page");
+
+	memset(data,0x33,sizeof(data));
+	flash_write(f,0,data);
+	flash_copy(f,0,last-1);
+	flash_read(f,last-1,other);
+	check(!memcmp(data,other,sizeof(data)),"copy into a page beyond 2 GiB");
+
+	flash_erase(f,last/TEST_PAGES_PER_BLOCK);
+	flash_read(f,last,other);
+	check(!memcmp(zero,other,sizeof(zero)),"erase the last block");
+
+	/* hand the FTL a clean device */
+	flash_erase(f,0);
+
+	check(disk_create(f,(int64_t)UINT32_MAX+1)==0,"disk_create rejects more than UINT32_MAX blocks");
+
+	int64_t nblocks = TEST_PAGES-2*TEST_PAGES_PER_BLOCK;
+	struct disk *d = disk_create(f,nblocks);
+	check(d!=0,"create a disk on the large drive");
+	if(d) {
+		memset(data,0x77,sizeof(data));
+		disk_write(d,nblocks-1,data);
+		disk_read(d,nblocks-1,other);
+		check(!memcmp(data,other,sizeof(data)),"write and read back the last disk block");
+
+		/* time spent in the FTL itself, outside the flash drive, must not grow with the device */
+		struct disk_stats before, after;
+		struct flash_stats fbefore, fafter;
+		disk_get_stats(d,&before);
+		flash_get_stats(f,&fbefore);
+		for(int i=0;i<TEST_TIMED_WRITES;i++) {
+			disk_write(d,i,data);
+		}
+		disk_get_stats(d,&after);
+		flash_get_stats(f,&fafter);
+		int64_t flash_us = (fafter.write_us+fafter.read_us+fafter.copy_us+fafter.erase_us)
+			- (fbefore.write_us+fbefore.read_us+fbefore.copy_us+fbefore.erase_us);
+		int64_t ftl_us = after.write_us - before.write_us - flash_us;
+		fprintf(stderr,"FTL overhead: %.1f us per write\n",(double)ftl_us/TEST_TIMED_WRITES);
+		check(ftl_us < TEST_TIMED_WRITES*TEST_MAX_FTL_US,"FTL time per write does not scan the device");
+
+		disk_close(d);
+	}
+
+	flash_close(f);
+	unlink(filename);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*
+Checks that read-ahead never returns stale data.
+Every read is compared with a shadow copy of what was last written,
+while scans overwrite blocks that are staged or still queued for prefetch.
+*/
+
+#define _XOPEN_SOURCE 500L
+
+#include "disk.h"
+#include "flash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_DISK_BLOCKS 512
+#define TEST_PAGES 1024
+#define TEST_PAGES_PER_BLOCK 16
+#define TEST_STREAMS 4          /* as many streams as the FTL tracks */
+#define TEST_REGION (TEST_DISK_BLOCKS/TEST_STREAMS)
+
+int failures = 0;
+int mismatches = 0;
+unsigned char shadow[TEST_DISK_BLOCKS];
+unsigned char next_value = 1;
+
+void check( int ok, const char *what )
+{
+	fprintf(stderr,"%s: %s\n",ok ? "PASS" : "FAIL",what);
+	if(!ok) failures++;
+}
+
+/* Write a fresh value to block and remember it. */
+void write_block( struct disk *d, int64_t block )
+{
+	char data[DISK_BLOCK_SIZE];
+
+	shadow[block] = next_value;
+	memset(data,next_value,sizeof(data));
+	disk_write(d,block,data);
+
+	next_value = next_value%250 + 1;
+}
+
+/* Read block and count it if it differs from the last value written. */
+void read_block( struct disk *d, int64_t block )
+{
+	char data[DISK_BLOCK_SIZE];
+	char expected[DISK_BLOCK_SIZE];
+
+	disk_read(d,block,data);
+	memset(expected,shadow[block],sizeof(expected));
+	if(memcmp(data,expected,sizeof(data))) {
+		fprintf(stderr,"block %d read back stale data\n",(int)block);
+		mismatches++;
+	}
+}
+
+int main()
+{
+	const char *filename = "test_readahead_flash";
+	struct disk_stats before, after;
+
+	struct flash_drive *f = flash_create(filename,TEST_PAGES,TEST_PAGES_PER_BLOCK);
+	check(f!=0,"create a flash drive");
+	if(!f) return 1;
+
+	struct disk *d = disk_create(f,TEST_DISK_BLOCKS);
+	check(d!=0,"create a disk");
+	if(!d) {
+		flash_close(f);
+		return 1;
+	}
+
+	for(int64_t b=0;b<TEST_DISK_BLOCKS;b++) {
+		write_block(d,b);
+	}
+
+	/*
+	A sequential scan that overwrites the next block and one a few steps
+	ahead. The first is usually staged and the second still queued, so this
+	covers ra_invalidate on both and the cancelled prefetch of the second.
+	*/
+	disk_get_stats(d,&before);
+	for(int64_t b=0;b<TEST_DISK_BLOCKS;b++) {
+		read_block(d,b);
+		if(b%3==0 && b+1<TEST_DISK_BLOCKS) write_block(d,b+1);
+		if(b%5==0 && b+4<TEST_DISK_BLOCKS) write_block(d,b+4);
+	}
+	disk_get_stats(d,&after);
+	check(mismatches==0,"sequential scan with overwrites returns the data last written");
+	check(after.prefetch_hits>before.prefetch_hits,"sequential scan with overwrites is served by read-ahead");
+
+	/*
+	Establish a strided stream per slot, overwriting inside its window, then
+	replace every stream with unrelated reads while its prefetches are still
+	queued. The next round reads over the dropped windows.
+	*/
+	for(int round=0;round<8;round++) {
+		for(int i=0;i<6;i++) {
+			for(int s=0;s<TEST_STREAMS;s++) {
+				int64_t b = s*TEST_REGION + round*12 + i*(s+1);
+				read_block(d,b);
+				if(i==4) write_block(d,b+2*(s+1));
+			}
+		}
+		for(int s=0;s<TEST_STREAMS;s++) {
+			read_block(d,s*TEST_REGION + TEST_REGION-1 - round);
+		}
+	}
+	check(mismatches==0,"dropped streams with overwrites return the data last written");
+
+	/*
+	Streams that read every block twice. A repeated read must not start a
+	new stream and push an established one out, so most reads still hit.
+	*/
+	disk_get_stats(d,&before);
+	int reads = 0;
+	for(int i=0;i<TEST_REGION;i++) {
+		for(int s=0;s<TEST_STREAMS;s++) {
+			int64_t b = s*TEST_REGION + i;
+			read_block(d,b);
+			read_block(d,b);
+			reads += 2;
+		}
+	}
+	disk_get_stats(d,&after);
+	check(mismatches==0,"repeated reads return the data last written");
+	check((after.prefetch_hits-before.prefetch_hits)*4 > reads,"repeated reads keep their streams");
+
+	disk_close(d);
+	flash_close(f);
+	unlink(filename);
+
+	return failures ? 1 : 0;
+}